@@ -7,8 +7,65 @@
 #include <sys/ioctl.h>
 #include <dirent.h>     // Provides directory reading capabilities
 #include <sys/stat.h>
+#include <fcntl.h>      // Provides open(), used to sync a directory after a rename
+#include <sys/mman.h>   // Provides mmap(), used to share the scheduler between forked children
+#include <sys/wait.h>   // Provides waitpid(), used to reap finished children
+#include <pthread.h>    // Provides process-shared locks for the scheduler
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include "dfs_trace.h"
 
 #define BUFFSIZE 1024
+#define TEMP_SUFFIX ".tmp-"     // Marks a part still being written; list and get skip these
+
+// === Scheduler limits ===
+#define SCHED_SLOTS 8                           // Requests served at once
+#define SCHED_BULK_SLOTS 4                      // Of those, how many may be bulk transfers or repairs
+#define SCHED_USER_SLOTS 2                      // Bulk transfers or repairs served at once for any one user
+#define SCHED_USER_INTERACTIVE_SLOTS 4          // Metadata requests or small reads served at once for any one user
+#define SCHED_USER_BANDWIDTH (64L*1024*1024)    // Bytes per second moved for any one user
+#define SCHED_SMALL_READ (1024L*1024)           // Gets up to this many bytes count as interactive
+#define SCHED_CHUNK (64*1024)                   // Transfers are throttled in pieces this big
+#define SCHED_MAX_REQUESTS 128                  // Requests waiting or running at once
+#define SCHED_MAX_USERS SCHED_MAX_REQUESTS      // Users with requests waiting or running at once
+
+// === Structs ===
+// Kinds of request, in order of how latency sensitive they are
+enum request_class { CLASS_METADATA, CLASS_SMALL_READ, CLASS_BULK, CLASS_REPAIR };
+// Share of the server each class gets for the same number of bytes
+double class_weight[] = {8.0, 4.0, 1.0, 0.5};
+
+struct sched_user {
+    char name[BUFFSIZE];
+    int requests;       // Requests waiting or running; the entry is free when zero
+    int running;        // Bulk transfers and repairs running
+    int interactive;    // Metadata requests and small reads running
+    double finish[4];   // Virtual time at which the user's admitted work of each class is done
+    double tokens;      // Bytes the user may still move before being throttled
+    double refilled;    // When tokens were last topped up
+};
+struct sched_request {
+    pid_t pid;          // Child serving the request; the entry is free when zero
+    int running;
+    int class;
+    int user;
+    long cost;          // Bytes charged to the user on admission
+    double start;       // Virtual start tag; lowest eligible tag runs first
+};
+// Lives in shared memory so every forked child sees the same queue
+struct scheduler {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    double vclock;
+    int running;
+    int bulk_running;
+    struct sched_user users[SCHED_MAX_USERS];
+    struct sched_request requests[SCHED_MAX_REQUESTS];
+};
+
+struct scheduler* global_sched;
+int global_request = -1;    // This child's entry in the scheduler, once admitted
 
 
 // === Debugging methods ===
@@ -42,7 +99,270 @@ char* getToken(char* str, char delim) {
     return ptr+1;
 }
 
+// === Scheduler Methods ===
+// Seconds on a clock that never jumps
+double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+// Creates the scheduler in memory shared with all children forked afterwards
+void setupScheduler() {
+    global_sched = mmap(NULL, sizeof(struct scheduler), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (global_sched == MAP_FAILED) {
+        debug("Error creating scheduler!");
+        exit(1);
+    }
+    memset(global_sched, 0, sizeof(struct scheduler));
+    pthread_mutexattr_t mutex_attr;
+    pthread_mutexattr_init(&mutex_attr);
+    pthread_mutexattr_setpshared(&mutex_attr, PTHREAD_PROCESS_SHARED);
+    // A child killed while holding the lock must not wedge every other process
+    pthread_mutexattr_setrobust(&mutex_attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&global_sched->lock, &mutex_attr);
+    pthread_mutexattr_destroy(&mutex_attr);
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setpshared(&cond_attr, PTHREAD_PROCESS_SHARED);
+    pthread_cond_init(&global_sched->cond, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+}
+// Takes over the lock if its last owner died holding it
+// The dead child's requests are freed by schedReap() once the parent reaps it
+void schedRecover(int err) {
+    if (err == EOWNERDEAD) {
+        debug("Recovering scheduler lock from a dead child");
+        pthread_mutex_consistent(&global_sched->lock);
+    }
+}
+void schedLock() {
+    schedRecover(pthread_mutex_lock(&global_sched->lock));
+}
+// Waits for the scheduler to change; caller holds the lock
+void schedWait() {
+    schedRecover(pthread_cond_wait(&global_sched->cond, &global_sched->lock));
+}
+// Finds the user's entry, claiming a free one if needed; caller holds the lock
+int schedFindUser(char* username) {
+    int i;
+    int free_user = -1;
+    for (i = 0; i < SCHED_MAX_USERS; i++) {
+        struct sched_user* u = &global_sched->users[i];
+        if (u->requests > 0 && areEqual(u->name, username)) {
+            return i;
+        }
+        if (u->requests == 0 && free_user == -1) {
+            free_user = i;
+        }
+    }
+    // Users coming back after being idle start level with everyone else
+    struct sched_user* u = &global_sched->users[free_user];
+    strcpy(u->name, username);
+    u->running = 0;
+    u->interactive = 0;
+    int class;
+    for (class = CLASS_METADATA; class <= CLASS_REPAIR; class++) {
+        u->finish[class] = global_sched->vclock;
+    }
+    u->tokens = SCHED_USER_BANDWIDTH;
+    u->refilled = now();
+    return free_user;
+}
+// Returns *1* if the request fits within the global, bulk and per-user limits; caller holds the lock
+int schedCanRun(struct sched_request* r) {
+    if (global_sched->running >= SCHED_SLOTS) {
+        return 0;
+    }
+    // Interactive requests have their own allowance, so a user's bulk jobs never hold up their list
+    struct sched_user* u = &global_sched->users[r->user];
+    if (r->class < CLASS_BULK) {
+        return u->interactive < SCHED_USER_INTERACTIVE_SLOTS;
+    }
+    if (u->running >= SCHED_USER_SLOTS || global_sched->bulk_running >= SCHED_BULK_SLOTS) {
+        return 0;
+    }
+    return 1;
+}
+// Returns *1* if the request is the eligible waiter with the lowest start tag; caller holds the lock
+int schedIsNext(int index) {
+    struct sched_request* r = &global_sched->requests[index];
+    if (!schedCanRun(r)) {
+        return 0;
+    }
+    int i;
+    for (i = 0; i < SCHED_MAX_REQUESTS; i++) {
+        struct sched_request* other = &global_sched->requests[i];
+        if (i == index || other->pid == 0 || other->running || !schedCanRun(other)) {
+            continue;
+        }
+        if (other->start < r->start || (other->start == r->start && i < index)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+// Blocks until the weighted fair queue lets this request run
+void schedAdmit(char* username, int class, long cost) {
+    schedLock();
+    // Wait for room in the request table
+    int index = -1;
+    while (1) {
+        int i;
+        for (i = 0; i < SCHED_MAX_REQUESTS; i++) {
+            if (global_sched->requests[i].pid == 0) {
+                index = i;
+                break;
+            }
+        }
+        if (index != -1) {
+            break;
+        }
+        schedWait();
+    }
+
+    // Tag the request: it starts after the user's previous work of the same class, scaled by the class
+    // Keeping a tag per class stops a user's small requests queueing behind their own bulk bytes
+    struct sched_request* r = &global_sched->requests[index];
+    r->pid = getpid();
+    r->running = 0;
+    r->class = class;
+    r->user = schedFindUser(username);
+    r->cost = cost;
+    struct sched_user* u = &global_sched->users[r->user];
+    r->start = u->finish[class] > global_sched->vclock ? u->finish[class] : global_sched->vclock;
+    u->finish[class] = r->start + cost / class_weight[class];
+    u->requests++;
+
+    while (!schedIsNext(index)) {
+        schedWait();
+    }
+    r->running = 1;
+    global_sched->running++;
+    if (class >= CLASS_BULK) {
+        global_sched->bulk_running++;
+        u->running++;
+    }
+    else {
+        u->interactive++;
+    }
+    if (r->start > global_sched->vclock) {
+        global_sched->vclock = r->start;
+    }
+    global_request = index;
+    pthread_mutex_unlock(&global_sched->lock);
+}
+// Frees a request's entry, charging the user for what it really moved; caller holds the lock
+void schedFree(int index, long actual) {
+    struct sched_request* r = &global_sched->requests[index];
+    struct sched_user* u = &global_sched->users[r->user];
+    u->finish[r->class] += (actual - r->cost) / class_weight[r->class];
+    if (r->running) {
+        global_sched->running--;
+        if (r->class >= CLASS_BULK) {
+            global_sched->bulk_running--;
+            u->running--;
+        }
+        else {
+            u->interactive--;
+        }
+    }
+    u->requests--;
+    r->pid = 0;
+    pthread_cond_broadcast(&global_sched->cond);
+}
+// Called by a child once it has finished serving its request
+void schedRelease(long actual) {
+    if (global_request == -1) {
+        return;
+    }
+    schedLock();
+    schedFree(global_request, actual);
+    pthread_mutex_unlock(&global_sched->lock);
+    global_request = -1;
+}
+// Called by the parent for a dead child, in case it exited without releasing its request
+void schedReap(pid_t pid) {
+    schedLock();
+    int i;
+    for (i = 0; i < SCHED_MAX_REQUESTS; i++) {
+        if (global_sched->requests[i].pid == pid) {
+            schedFree(i, global_sched->requests[i].cost);
+        }
+    }
+    pthread_mutex_unlock(&global_sched->lock);
+}
+// Takes bytes from the user's token bucket, sleeping off any overdraft
+void schedThrottle(long bytes) {
+    if (global_request == -1) {
+        return;
+    }
+    schedLock();
+    struct sched_user* u = &global_sched->users[global_sched->requests[global_request].user];
+    double t = now();
+    u->tokens += (t - u->refilled) * SCHED_USER_BANDWIDTH;
+    if (u->tokens > SCHED_USER_BANDWIDTH) {
+        u->tokens = SCHED_USER_BANDWIDTH;
+    }
+    u->refilled = t;
+    u->tokens -= bytes;
+    double overdraft = -u->tokens;
+    pthread_mutex_unlock(&global_sched->lock);
+    if (overdraft > 0) {
+        usleep((useconds_t) (overdraft / SCHED_USER_BANDWIDTH * 1e6));
+    }
+}
+// Reaps finished children so they don't linger as zombies or hold scheduler slots
+void reapChildren() {
+    pid_t pid;
+    while ((pid = waitpid(-1, NULL, WNOHANG)) > 0) {
+        schedReap(pid);
+    }
+}
+// Only exists so SIGCHLD interrupts accept() and children get reaped promptly
+void onChildExit(int sig) {
+}
+
 // === Network Methods ===
+// Reads until len bytes have arrived; returns bytes read, less than len only on EOF or error
+long readFull(int fd, char* buffer, long len) {
+    long total = 0;
+    while (total < len) {
+        long n = read(fd, buffer + total, len - total);
+        if (n <= 0) {
+            break;
+        }
+        total += n;
+    }
+    return total;
+}
+// Writes a buffer in throttled chunks; returns bytes written
+long writeThrottled(int fd, char* buffer, long len) {
+    long total = 0;
+    while (total < len) {
+        long chunk = len - total < SCHED_CHUNK ? len - total : SCHED_CHUNK;
+        schedThrottle(chunk);
+        long n = write(fd, buffer + total, chunk);
+        if (n <= 0) {
+            break;
+        }
+        total += n;
+    }
+    return total;
+}
+// Reads a buffer in throttled chunks; returns bytes read, less than len only on EOF or error
+long readThrottled(int fd, char* buffer, long len) {
+    long total = 0;
+    while (total < len) {
+        long chunk = len - total < SCHED_CHUNK ? len - total : SCHED_CHUNK;
+        schedThrottle(chunk);
+        long n = readFull(fd, buffer + total, chunk);
+        total += n;
+        if (n < chunk) {
+            break;
+        }
+    }
+    return total;
+}
 void setupServerSocket(int port, struct sockaddr_in* server_address, int* server_fd) {
     *server_fd = socket(AF_INET, SOCK_STREAM, 0);
     if ((*server_fd) < 0) {
@@ -85,25 +405,91 @@ void getFile(char* filename, long* file_content_size, char** file_content) {
     }
 }
 // Creates proper message when the command is "list"
-// Writes a file given a file component
-void writeFile(char* filename, char* file_data, int file_size) {
+// Writes a file given a file component; only returns once the data and its name have reached the disk
+// The data goes to a temp file that is renamed into place, so a crash never leaves a torn part behind
+// Returns *1* on success; anything short of that must not be acknowledged as durable
+int writeFile(char* dirname, char* filename, char* file_data, int file_size) {
+    char* temp_filename = calloc(1, BUFFSIZE + 32);
+    sprintf(temp_filename, "%s%s%d", filename, TEMP_SUFFIX, getpid());
     FILE* f;
-    f = fopen(filename, "wb" );
+    f = fopen(temp_filename, "wb" );
     if (f == NULL) {
         debug("Error opening file to write to!");
-        fclose(f);
-        exit(1);
+        free(temp_filename);
+        return 0;
+    }
+    int ok = fwrite(file_data, 1, file_size, f) == file_size;
+    ok = fflush(f) == 0 && ok;
+    ok = fsync(fileno(f)) == 0 && ok;
+    ok = fclose(f) == 0 && ok;
+    ok = ok && rename(temp_filename, filename) == 0;
+    if (!ok) {
+        debug("Error writing file to disk!");
+        unlink(temp_filename);
+        free(temp_filename);
+        return 0;
+    }
+    free(temp_filename);
+
+    // The rename itself is only durable once the directory is synced
+    int dir_fd = open(dirname, O_RDONLY | O_DIRECTORY);
+    ok = dir_fd >= 0 && fsync(dir_fd) == 0;
+    if (dir_fd >= 0) {
+        close(dir_fd);
+    }
+    if (!ok) {
+        debug("Error syncing directory to disk!");
     }
-    fwrite(file_data, 1, file_size, f);
-    fclose(f);
+    return ok;
 }
-void handleListAndGet(int client_fd, char* dirname) {
+// Returns *1* if a stored part ".name,part" belongs to the wanted file; NULL wants every file
+// Parts still being written, or left half-written by a crash, belong to no file
+int partBelongsTo(char* stored_name, char* wanted) {
+    char* comma = strrchr(stored_name, ',');
+    if (comma != NULL && strstr(comma, TEMP_SUFFIX) != NULL) {
+        return 0;
+    }
+    if (wanted == NULL) {
+        return 1;
+    }
+    if (comma == NULL) {
+        return 0;
+    }
+    long name_len = comma - (stored_name + 1);
+    return name_len == strlen(wanted) && strncmp(stored_name + 1, wanted, name_len) == 0;
+}
+// Adds up the bytes stored for the wanted file, used to size a get before serving it
+long storedSize(char* dirname, char* wanted) {
+    long total = 0;
+    DIR *directory = opendir(dirname);
+    if (directory != NULL) {
+        struct dirent *dirStruct;
+        while ((dirStruct = readdir(directory)) != NULL) {
+            if (!areEqual(dirStruct->d_name, ".") && !areEqual(dirStruct->d_name, "..") && partBelongsTo(dirStruct->d_name, wanted)) {
+                char *path = calloc(1, BUFFSIZE);
+                struct stat st;
+                strcpy(path, dirname);
+                strcat(path, dirStruct->d_name);
+                if (stat(path, &st) == 0) {
+                    total += st.st_size;
+                }
+                free(path);
+            }
+        }
+        closedir(directory);
+    }
+    return total;
+}
+// Sends the parts of the wanted file for "get", or just the part names and sizes for "list" (wanted is NULL)
+// Returns the number of bytes sent
+long handleListAndGet(int client_fd, char* dirname, char* wanted) {
+    long sent = 0;
     DIR *directory;
     struct dirent *dirStruct;
     directory = opendir(dirname);
     if (directory != NULL) {
         while ((dirStruct = readdir(directory)) != NULL) {
-            if (!areEqual(dirStruct->d_name, ".") && !areEqual(dirStruct->d_name, "..")) {
+            if (!areEqual(dirStruct->d_name, ".") && !areEqual(dirStruct->d_name, "..") && partBelongsTo(dirStruct->d_name, wanted)) {
                 // For every file, send its core components and the file itself
                 char *temp_filename = calloc(1, BUFFSIZE);
                 char *temp_dirname = calloc(1, BUFFSIZE);
@@ -117,19 +503,34 @@ void handleListAndGet(int client_fd, char* dirname) {
                 char *temp_filepart = getToken(temp_filename, ','); // Separate filename from the file part
                 strcat(filename, temp_filename);
                 strcat(filepart, temp_filepart);
-                long file_content_size;
-                char *file_content;
                 strcat(temp_dirname, dirname);
                 strcat(temp_dirname, dirStruct->d_name);
-                getFile(temp_dirname, &file_content_size, &file_content);
-                sprintf(partsize, "%lu", file_content_size);
 
                 // Send components
                 write(client_fd, "not done", BUFFSIZE);
                 write(client_fd, filename, BUFFSIZE);
                 write(client_fd, filepart, BUFFSIZE);
-                write(client_fd, partsize, BUFFSIZE);
-                write(client_fd, file_content, file_content_size);
+                sent += 4*BUFFSIZE;
+                if (wanted == NULL) {
+                    // Listing only needs to know the part exists; don't read it off disk
+                    struct stat st;
+                    stat(temp_dirname, &st);
+                    sprintf(partsize, "%ld", (long) st.st_size);
+                    write(client_fd, partsize, BUFFSIZE);
+                }
+                else {
+                    long file_content_size;
+                    char *file_content;
+                    long span = traceBegin();
+                    getFile(temp_dirname, &file_content_size, &file_content);
+                    traceEnd("disk read", span);
+                    sprintf(partsize, "%lu", file_content_size);
+                    write(client_fd, partsize, BUFFSIZE);
+                    span = traceBegin();
+                    sent += writeThrottled(client_fd, file_content, file_content_size);
+                    traceEnd("network transfer", span);
+                    free(file_content);
+                }
 
                 free(temp_filename-1);
                 free(temp_dirname);
@@ -138,33 +539,48 @@ void handleListAndGet(int client_fd, char* dirname) {
                 free(partsize);
             }
         }
-        // Send message indicating that we are done listing
-        char* send_buffer = calloc(1, BUFFSIZE);
-        strcpy(send_buffer, "done");
-        write(client_fd, send_buffer, BUFFSIZE);
-        free(send_buffer);
         closedir(directory);
     }
+    // Send message indicating that we are done listing, even if the directory couldn't be read,
+    // since the client waits for it before sending its next request on this connection
+    char* send_buffer = calloc(1, BUFFSIZE);
+    strcpy(send_buffer, "done");
+    write(client_fd, send_buffer, BUFFSIZE);
+    free(send_buffer);
+    return sent;
 }
-// Receives file and writes it if the command is put
-void handlePut(int client_fd, char* dirname, char* filename) {
+// Receives file and writes it if the command is put; each part is acknowledged once it is on disk
+// Counts the bytes received and returns *1* if both parts arrived
+int handlePut(int client_fd, char* dirname, char* filename, long* received) {
+    *received = 0;
     int i;
     for(i = 0; i < 2; i++) {
         // Generate buffers to hold components
         char *filepart = calloc(1, BUFFSIZE);
         char *partsize = calloc(1, BUFFSIZE);
 
-        // Read in components
-        read(client_fd, filepart, BUFFSIZE);
-        read(client_fd, partsize, BUFFSIZE);
+        // Read in components; give up on this put if the client went away
+        if (readFull(client_fd, filepart, BUFFSIZE) < BUFFSIZE || readFull(client_fd, partsize, BUFFSIZE) < BUFFSIZE) {
+            free(filepart);
+            free(partsize);
+            return 0;
+        }
         // Use partsize to create buffer large enough to store file data and read it
         int partsize_int = atoi(partsize);
         char *partdata = calloc(1, partsize_int);
-        read(client_fd, partdata, partsize_int);
+        long span = traceBegin();
+        long part_read = readThrottled(client_fd, partdata, partsize_int);
+        traceEnd("network transfer", span);
+        if (part_read < partsize_int) {
+            free(filepart);
+            free(partsize);
+            free(partdata);
+            return 0;
+        }
+        *received += 2*BUFFSIZE + partsize_int;
 
         printf("%s: Part    #: %s\n", dirname, filepart);
         printf("%s: Part Size: %s\n", dirname, partsize);
-        printf("%s: Part Data: %s\n", dirname, partdata);
 
         // Compile the correct filename
         char* true_filename = calloc(1, BUFFSIZE);
@@ -174,30 +590,59 @@ void handlePut(int client_fd, char* dirname, char* filename) {
         strcat(true_filename, ",");
         strcat(true_filename, filepart);
 
-        // Write data to file
-        writeFile(true_filename, partdata, atoi(partsize));
+        // Write data to file, then tell the client this part is durable
+        span = traceBegin();
+        int durable = writeFile(dirname, true_filename, partdata, atoi(partsize));
+        traceEnd("disk write", span);
+        char *ack = calloc(1, BUFFSIZE);
+        // A nack makes the client treat this copy as not durable and retry it
+        sprintf(ack, "%s %s", durable ? "ack" : "nack", filepart);
+        write(client_fd, ack, BUFFSIZE);
 
+        free(ack);
+        free(true_filename);
         free(filepart);
         free(partsize);
         free(partdata);
     }
+    return 1;
 }
 // Interprets client request and hands it off to each command's method
-void handleRequest(int client_fd, char* server_name) {
+// Returns *1* if the connection is ready for another request, *0* once the client is gone
+int handleRequest(int client_fd, char* server_name) {
     // Start by reading BUFFSIZE bytes; Assuming command, filename, and username all fit into BUFFSIZE
-    char* reci_buffer = calloc(1, BUFFSIZE);
+    char* reci_buffer = calloc(1, BUFFSIZE+1);
     char* command = calloc(1, BUFFSIZE);
     char* filename = calloc(1, BUFFSIZE);
     char* username = calloc(1, BUFFSIZE);
     char* dirname = calloc(1, BUFFSIZE);
+    char* request_id = calloc(1, BUFFSIZE);
 
-    // Get components one at a time
-    read(client_fd, reci_buffer, BUFFSIZE);
-    strcpy(command, reci_buffer);
-    read(client_fd, reci_buffer, BUFFSIZE);
-    strcpy(filename, reci_buffer);
-    read(client_fd, reci_buffer, BUFFSIZE);
-    strcpy(username, reci_buffer);
+    // Get components one at a time; running out means the client closed the connection
+    int complete = readFull(client_fd, reci_buffer, BUFFSIZE) == BUFFSIZE;
+    strncpy(command, reci_buffer, BUFFSIZE - 1);
+    // Puts carry the bytes they are about to send after the command, as in "put 1048576"
+    char* put_bytes = getToken(command, ' ');
+    // Time the rest of the header from here, as waiting for the first block is just the client being idle
+    long span = traceBegin();
+    complete = complete && readFull(client_fd, reci_buffer, BUFFSIZE) == BUFFSIZE;
+    strncpy(filename, reci_buffer, BUFFSIZE - 1);
+    complete = complete && readFull(client_fd, reci_buffer, BUFFSIZE) == BUFFSIZE;
+    strncpy(username, reci_buffer, BUFFSIZE - 1);
+    complete = complete && readFull(client_fd, reci_buffer, BUFFSIZE) == BUFFSIZE;
+    strncpy(request_id, reci_buffer, REQUEST_ID_SIZE - 1);
+    if (!complete) {
+        free(reci_buffer);
+        free(command);
+        free(filename);
+        free(username);
+        free(dirname);
+        free(request_id);
+        return 0;
+    }
+    // Tag our spans with the client's request so they line up with its own
+    traceSetRequest(request_id);
+    traceEnd("header receive", span);
     // Construct full directory name
     strcpy(dirname, server_name);
     strcat(dirname, "/");
@@ -212,18 +657,47 @@ void handleRequest(int client_fd, char* server_name) {
     debug(username);
     debug(dirname);
 
-    if(areEqual(command, "list") || areEqual(command, "get")) {
-        handleListAndGet(client_fd, dirname);
+    // Classify the request and wait for the scheduler to let it run
+    int class;
+    long cost;
+    if(areEqual(command, "list")) {
+        class = CLASS_METADATA;
+        cost = BUFFSIZE;
+    }
+    else if(areEqual(command, "get")) {
+        cost = storedSize(dirname, filename);
+        class = cost <= SCHED_SMALL_READ ? CLASS_SMALL_READ : CLASS_BULK;
     }
     else {
-        handlePut(client_fd, dirname, filename);
+        // Charged for the parts announced in the header; corrected to what really arrived on release
+        class = areEqual(command, "repair") ? CLASS_REPAIR : CLASS_BULK;
+        cost = put_bytes != NULL ? atol(put_bytes) : 0;
     }
+    span = traceBegin();
+    schedAdmit(username, class, cost);
+    traceEnd("queue wait", span);
+
+    long actual;
+    int keep_alive = 1;
+    if(areEqual(command, "list")) {
+        actual = handleListAndGet(client_fd, dirname, NULL);
+    }
+    else if(areEqual(command, "get")) {
+        actual = handleListAndGet(client_fd, dirname, filename);
+    }
+    else {
+        // A put cut short leaves the connection mid-stream, so it can't be reused
+        keep_alive = handlePut(client_fd, dirname, filename, &actual);
+    }
+    schedRelease(actual);
 
     free(reci_buffer);
     free(command);
     free(filename);
     free(username);
     free(dirname);
+    free(request_id);
+    return keep_alive;
 }
 
 // ===== MAIN METHOD =====
@@ -231,17 +705,29 @@ int main(int argc, char **argv) {
     // Handle params
     int port = checkForParameters(argc, argv);
     char* dirname = argv[1];
+    traceInit(dirname);
 
     // Setup socket to listen
     struct sockaddr_in server_address;
     int server_fd;
     setupServerSocket(port, &server_address, &server_fd);
+    setupScheduler();
+
+    // Let child exits interrupt accept() so they are reaped right away
+    struct sigaction child_action;
+    memset(&child_action, 0, sizeof(child_action));
+    child_action.sa_handler = onChildExit;
+    sigaction(SIGCHLD, &child_action, NULL);
 
     while(1) {
+        reapChildren();
         // Setup client socket to reply on
         int client_fd;
         int server_address_size = sizeof(server_address);
         if ((client_fd = accept(server_fd, (struct sockaddr *)&server_address, (socklen_t*)&server_address_size)) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
             debug("Error on accept!");
             exit(1);
         }
@@ -250,7 +736,11 @@ int main(int argc, char **argv) {
         if(!fork()) {
         //if(1) {
             close(server_fd);           // Child need not deal with server connection socket
-            handleRequest(client_fd, dirname);   // Interpret the data that came in
+            // Interpret the data that came in; clients may send more requests on the same connection
+            while (handleRequest(client_fd, dirname)) {
+                traceFlush();
+            }
+            traceFlush();
             close(client_fd);           // After we're done, we no longer need the response socket
             exit(0);             // Child finished all work
         }
@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>          // Provides open() flags for the trace file
+#include <time.h>
+#include <pthread.h>        // Provides the thread-exit hook that frees each ring
+#include <sys/syscall.h>    // Provides SYS_gettid, used as the trace thread ID
+#include "dfs_trace.h"
+
+#define TRACE_EVENT_SIZE 512    // Upper bound on one formatted event
+
+// === Structs ===
+struct trace_span {
+    char const* name;
+    long start;                 // Microseconds since the epoch, so processes line up
+    long duration;
+    char request[REQUEST_ID_SIZE];
+};
+struct trace_ring {
+    struct trace_span spans[TRACE_RING];
+    long next;                  // Spans recorded since the last flush; next % TRACE_RING is the slot to fill
+};
+
+int trace_fd = -1;              // Trace file, or -1 when tracing is off
+int trace_pid;                  // Process lane every span is drawn in; shared by forked children
+long trace_counter = 0;         // Requests started by this process, used to build IDs
+__thread struct trace_ring* trace_ring = NULL;  // Allocated on a thread's first span, kept until it exits
+pthread_key_t trace_ring_key;
+pthread_once_t trace_ring_once = PTHREAD_ONCE_INIT;
+__thread char trace_request[REQUEST_ID_SIZE];
+
+// === Helper Methods ===
+// Microseconds on the wall clock
+long traceNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
+}
+// Copies a name, swapping anything unsafe in a filename or JSON string for '_'
+void traceSanitize(char* dest, char const* src, int size) {
+    int i;
+    for (i = 0; i < size - 1 && src[i] != '\0'; i++) {
+        char c = src[i];
+        int safe = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '_';
+        dest[i] = safe ? c : '_';
+    }
+    dest[i] = '\0';
+}
+
+// Frees a thread's ring when the thread exits
+void traceFreeRing(void* ring) {
+    free(ring);
+}
+void traceCreateRingKey() {
+    pthread_key_create(&trace_ring_key, traceFreeRing);
+}
+
+// === Tracing Methods ===
+void traceInit(char const* process_name) {
+    char const* dir = getenv("DFS_TRACE");
+    if (dir == NULL || dir[0] == '\0') {
+        return;
+    }
+    // Servers are named after their directory, so keep only the last path component
+    char const* base = strrchr(process_name, '/');
+    char name[REQUEST_ID_SIZE];
+    traceSanitize(name, base != NULL ? base + 1 : process_name, REQUEST_ID_SIZE);
+    trace_pid = getpid();
+
+    char* path = calloc(1, strlen(dir) + REQUEST_ID_SIZE + 32);
+    sprintf(path, "%s/%s-%d.json", dir, name, trace_pid);
+    trace_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    free(path);
+    if (trace_fd < 0) {
+        fprintf(stderr, "Error opening trace file in %s!\n", dir);
+        return;
+    }
+    // The closing ']' is optional in the Chrome trace format, so events can be appended forever
+    char event[TRACE_EVENT_SIZE];
+    int len = snprintf(event, TRACE_EVENT_SIZE, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"%s\"}},\n", trace_pid, name);
+    write(trace_fd, event, len);
+}
+void traceNewRequest(char* request_id) {
+    long count = __sync_fetch_and_add(&trace_counter, 1);
+    snprintf(request_id, REQUEST_ID_SIZE, "%d-%ld-%ld", getpid(), (long) time(NULL), count);
+}
+void traceSetRequest(char const* request_id) {
+    if (trace_fd < 0) {
+        return;
+    }
+    traceSanitize(trace_request, request_id, REQUEST_ID_SIZE);
+}
+long traceBegin() {
+    if (trace_fd < 0) {
+        return 0;
+    }
+    return traceNow();
+}
+void traceEnd(char const* name, long start) {
+    if (start == 0) {
+        return;
+    }
+    if (trace_ring == NULL) {
+        pthread_once(&trace_ring_once, traceCreateRingKey);
+        trace_ring = calloc(1, sizeof(struct trace_ring));
+        pthread_setspecific(trace_ring_key, trace_ring);
+    }
+    struct trace_span* span = &trace_ring->spans[trace_ring->next % TRACE_RING];
+    span->name = name;
+    span->start = start;
+    span->duration = traceNow() - start;
+    strcpy(span->request, trace_request);
+    trace_ring->next++;
+}
+void traceFlush() {
+    if (trace_fd < 0 || trace_ring == NULL) {
+        return;
+    }
+    // Skip whatever was overwritten before we got here
+    long first = 0;
+    if (trace_ring->next > TRACE_RING) {
+        first = trace_ring->next - TRACE_RING;
+    }
+    long tid = syscall(SYS_gettid);
+
+    // Build every event into one buffer so the append lands in a single write
+    char* buffer = malloc((trace_ring->next - first) * TRACE_EVENT_SIZE + 1);
+    long len = 0;
+    long i;
+    for (i = first; i < trace_ring->next; i++) {
+        struct trace_span* span = &trace_ring->spans[i % TRACE_RING];
+        len += snprintf(buffer + len, TRACE_EVENT_SIZE,
+                "{\"name\":\"%s\",\"cat\":\"dfs\",\"ph\":\"X\",\"ts\":%ld,\"dur\":%ld,\"pid\":%d,\"tid\":%ld,\"args\":{\"request\":\"%s\"}},\n",
+                span->name, span->start, span->duration, trace_pid, tid, span->request);
+    }
+    write(trace_fd, buffer, len);
+    free(buffer);
+
+    // Keep the ring for the thread's next spans
+    trace_ring->next = 0;
+}
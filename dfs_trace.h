@@ -0,0 +1,25 @@
+#ifndef DFS_TRACE_H
+#define DFS_TRACE_H
+
+// Request tracing shared by the client and the servers
+// Set DFS_TRACE to a directory to turn it on; each process then writes Chrome trace events to
+// <DFS_TRACE>/<name>-<pid>.json, and merge_traces.sh joins them into one timeline
+// When DFS_TRACE is unset every call below returns after a single check
+
+#define TRACE_RING 4096         // Spans each thread holds between flushes; the oldest are overwritten
+#define REQUEST_ID_SIZE 64
+
+// Opens this process's trace file if tracing is on; call once, before forking or starting threads
+void traceInit(char const* process_name);
+// Fills request_id with a new ID, unique across processes on this host
+void traceNewRequest(char* request_id);
+// Tags the calling thread's following spans with the request they belong to
+void traceSetRequest(char const* request_id);
+// Returns a start timestamp to hand to traceEnd(), or 0 when tracing is off
+long traceBegin();
+// Records a span from start until now; name must be a string literal, as only the pointer is kept
+void traceEnd(char const* name, long start);
+// Writes the calling thread's spans to the trace file and empties its ring buffer
+void traceFlush();
+
+#endif
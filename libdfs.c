@@ -0,0 +1,938 @@
+#define _GNU_SOURCE         // Provides program_invocation_short_name
+#include <stdio.h>
+#include <stdlib.h>         // Provides standard functions like exit() & atoi()
+#include <string.h>         // Provides string functions like strcmp()
+#include <sys/socket.h>     // Provides socket functions
+#include <netinet/in.h>     // Provides socket structs like sockaddr_in
+#include <unistd.h>         // Provides read(), used when reading servers messages
+#include <netdb.h>          // Provides socket structs like addr_info
+#include <openssl/md5.h>    // Provides methods needed to create MD5 hash
+#include <pthread.h>        // Provides the threads operations run on
+#include <errno.h>
+#include "dfs_trace.h"
+#include "libdfs.h"
+
+#define BUFFSIZE 1024
+#define PUT_RETRIES 3       // Times a failed server write is retried in the background
+#define POOL_SIZE 4         // Idle connections kept per server
+
+// Only the DFS_API functions from libdfs.h are exported; the makefile hides everything else, dfs_trace.c included
+
+enum op_type { OP_PUT, OP_GET, OP_LIST };
+
+// === Structs ===
+struct dfs_file {
+    char* part[4];
+    char name[BUFFSIZE];
+    int part_size[4];
+    int present[4];         // List only learns that parts exist, so part[] stays NULL
+    char* alt[4];           // A replica whose size disagrees with part[], kept until reassembly picks one
+    int alt_size[4];
+    int has_alt[4];
+};
+struct dfs_session {
+    char username[BUFFSIZE];
+    char host[DFS_SERVERS][BUFFSIZE];
+    char port[DFS_SERVERS][16];
+    int write_quorum;       // Durable copies of every part required before a put completes
+    int idle[DFS_SERVERS][POOL_SIZE];
+    int idle_count[DFS_SERVERS];
+    int refs;               // The user, plus every operation and background writer still running
+    int puts;               // Puts whose writers are still running
+    pthread_mutex_t lock;
+    pthread_cond_t cond;    // Signalled as puts finish
+};
+struct dfs_op {
+    struct dfs_session* session;
+    int type;
+    char filename[BUFFSIZE];
+    char request_id[REQUEST_ID_SIZE];
+    char* data;             // Put input, then get output
+    long size;
+    struct dfs_file* files; // List output
+    int file_count;
+    int copies;
+    int status;
+    int refs;               // The user and the thread running the operation
+    int notify_fd[2];       // Pipe made readable on completion; created on first dfsOpFd()
+    dfs_callback callback;
+    void* user_data;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+// Shared state of a single put; freed by whoever releases the last reference
+struct put_job {
+    struct dfs_session* session;
+    char* part[4];
+    long part_size[4];
+    char filename[BUFFSIZE];
+    char request_id[REQUEST_ID_SIZE];
+    int v;
+    int acks[4];    // Durable copies acknowledged for each part
+    int failed[4];  // Copies of each part that were given up on
+    int refs;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+// Arguments handed to each server's writer thread
+struct put_writer {
+    struct put_job* job;
+    int server_id;
+};
+
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+
+// === String Manipulation Methods ===
+// Compares two strings and returns *1* if they are the same
+static int areEqual(char const* str1, char const* str2) {
+    return strcmp(str1, str2) == 0;
+}
+// Modify string to be itself until a delimiter; return the remaining string
+static char* getToken(char* str, char delim) {
+    char* ptr = strchr(str, delim);
+    if(ptr == NULL) {
+        return NULL;
+    }
+    *ptr = '\0';
+    return ptr+1;
+}
+// Converts a string to its MD5 hash
+// Thanks Todd! - https://stackoverflow.com/questions/7627723/how-to-create-a-md5-hash-of-a-string-in-c
+static char* str2md5(const char* str, long length) {
+    int n;
+    MD5_CTX c;
+    unsigned char digest[16];
+    char *out = (char*)malloc(33);
+    MD5_Init(&c);
+    while (length > 0) {
+        if (length > 512) {
+            MD5_Update(&c, str, 512);
+        } else {
+            MD5_Update(&c, str, length);
+        }
+        length -= 512;
+        str += 512;
+    }
+    MD5_Final(digest, &c);
+    for (n = 0; n < 16; ++n) {
+        snprintf(&(out[n*2]), 16*2, "%02x", (unsigned int)digest[n]);
+    }
+    return out;
+}
+// Converts a single hex character to an int
+// Thanks Paul! - https://stackoverflow.com/questions/26839558/hex-char-to-int-conversion
+static int hex2int(char ch) {
+    if (ch >= '0' && ch <= '9')
+        return ch - '0';
+    if (ch >= 'A' && ch <= 'F')
+        return ch - 'A' + 10;
+    if (ch >= 'a' && ch <= 'f')
+        return ch - 'a' + 10;
+    return -1;
+}
+
+// === Config Methods ===
+// Reads the servers and write quorum from the client config; returns *1* if all servers were found
+static int readConfig(struct dfs_session* session, char const* config_path) {
+    FILE* f = fopen(config_path, "r");
+    if (f == NULL) {
+        return 0;
+    }
+    int servers = 0;
+    char * line = NULL;
+    size_t len = 0;
+    session->write_quorum = 1;
+    while ((getline(&line, &len, f)) != -1) {
+        getToken(line, '\n');  // Strip newline!
+        char* value = getToken(line, ' ');
+        if(value == NULL) {
+            continue;
+        }
+        if(areEqual(line, "WriteQuorum")) {
+            session->write_quorum = atoi(value);
+        }
+        // Lines look like "Server DFS1 127.0.0.1:10001"
+        else if(areEqual(line, "Server") && servers < DFS_SERVERS) {
+            char* address = getToken(value, ' ');
+            char* port = address != NULL ? getToken(address, ':') : NULL;
+            if(port != NULL) {
+                snprintf(session->host[servers], BUFFSIZE, "%s", address);
+                snprintf(session->port[servers], 16, "%s", port);
+                servers++;
+            }
+        }
+    }
+    free(line);
+    fclose (f);
+    if(session->write_quorum < 1) {
+        session->write_quorum = 1;
+    }
+    if(session->write_quorum > DFS_REPLICAS) {
+        session->write_quorum = DFS_REPLICAS;
+    }
+    return servers == DFS_SERVERS;
+}
+// Returns *1* if the username & password are in the password file
+static int validLogin(char const* passwords_path, char const* username, char const* password) {
+    FILE* f = fopen(passwords_path, "r");
+    if (f == NULL) {
+        return -1;
+    }
+    int valid = 0;
+    char * line = NULL;
+    size_t len = 0;
+    while (!valid && (getline(&line, &len, f)) != -1) {
+        getToken(line, '\n');  // Strip newline!
+        char* f_password = getToken(line, ' ');
+        valid = f_password != NULL && areEqual(line, username) && areEqual(f_password, password);
+    }
+    free(line);
+    fclose (f);
+    return valid;
+}
+
+// === Network Methods ===
+// Reads until len bytes have arrived; returns bytes read, less than len only on EOF or error
+static long readFull(int fd, char* buffer, long len) {
+    long total = 0;
+    while (total < len) {
+        long n = read(fd, buffer + total, len - total);
+        if (n <= 0) {
+            break;
+        }
+        total += n;
+    }
+    return total;
+}
+// Writes all len bytes; a server that went away fails the write instead of raising SIGPIPE
+static int writeFull(int fd, char const* buffer, long len) {
+    long total = 0;
+    while (total < len) {
+        long n = send(fd, buffer + total, len - total, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return 0;
+        }
+        total += n;
+    }
+    return 1;
+}
+// Opens a new connection to a server; returns -1 if it is down
+// Touches no shared state, so put writer threads can call it while other operations run
+static int connectServer(struct dfs_session* session, int server_id) {
+    long span = traceBegin();
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    if (getaddrinfo(session->host[server_id], session->port[server_id], &hints, &res)) {
+        traceEnd("connect", span);
+        return -1;
+    }
+    int sockfd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (sockfd >= 0 && connect(sockfd, res->ai_addr, res->ai_addrlen)) {
+        close(sockfd);
+        sockfd = -1;
+    }
+    freeaddrinfo(res);
+    traceEnd("connect", span);
+    return sockfd;
+}
+// Takes an idle connection to the server if there is one, else opens a new one
+static int acquireConnection(struct dfs_session* session, int server_id, int* reused) {
+    pthread_mutex_lock(&session->lock);
+    int fd = -1;
+    if (session->idle_count[server_id] > 0) {
+        fd = session->idle[server_id][--session->idle_count[server_id]];
+    }
+    pthread_mutex_unlock(&session->lock);
+    *reused = fd >= 0;
+    if (fd < 0) {
+        fd = connectServer(session, server_id);
+    }
+    return fd;
+}
+// Returns a connection that finished its request cleanly to the pool, or closes it
+static void releaseConnection(struct dfs_session* session, int server_id, int fd) {
+    pthread_mutex_lock(&session->lock);
+    if (session->idle_count[server_id] < POOL_SIZE) {
+        session->idle[server_id][session->idle_count[server_id]++] = fd;
+        fd = -1;
+    }
+    pthread_mutex_unlock(&session->lock);
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+// Sends the command, filename, username and request ID that begin every request
+static int sendRequest(int server_fd, char const* command, char const* filename, char const* username, char const* request_id) {
+    long span = traceBegin();
+    char* send_buffer = calloc(4, BUFFSIZE);
+    strncpy(send_buffer, command, BUFFSIZE - 1);
+    strncpy(send_buffer + BUFFSIZE, filename, BUFFSIZE - 1);
+    strncpy(send_buffer + 2*BUFFSIZE, username, BUFFSIZE - 1);
+    strncpy(send_buffer + 3*BUFFSIZE, request_id, BUFFSIZE - 1);
+    int sent = writeFull(server_fd, send_buffer, 4*BUFFSIZE);
+    free(send_buffer);
+    traceEnd("header send", span);
+    return sent;
+}
+
+// === Session Methods ===
+// The library owns tracing for the whole process, so its trace file is named after the program using it
+static void startTracing() {
+    traceInit(program_invocation_short_name);
+}
+struct dfs_session* dfsOpen(char const* config_path, char const* username, char const* password, int* status) {
+    pthread_once(&trace_once, startTracing);
+    if (config_path == NULL) {
+        config_path = "dfc.conf";
+    }
+    struct dfs_session* session = calloc(1, sizeof(struct dfs_session));
+    if (!readConfig(session, config_path)) {
+        free(session);
+        *status = DFS_ERR_CONFIG;
+        return NULL;
+    }
+
+    // The password file sits next to the config
+    char* passwords_path = calloc(1, strlen(config_path) + BUFFSIZE);
+    strcpy(passwords_path, config_path);
+    char* dir_end = strrchr(passwords_path, '/');
+    strcpy(dir_end != NULL ? dir_end + 1 : passwords_path, "dfc_passwords.conf");
+    int valid = validLogin(passwords_path, username, password);
+    free(passwords_path);
+    if (valid != 1) {
+        free(session);
+        *status = valid < 0 ? DFS_ERR_CONFIG : DFS_ERR_LOGIN;
+        return NULL;
+    }
+
+    snprintf(session->username, BUFFSIZE, "%s", username);
+    session->refs = 1;
+    pthread_mutex_init(&session->lock, NULL);
+    pthread_cond_init(&session->cond, NULL);
+    *status = DFS_OK;
+    return session;
+}
+// Drops a reference to a session, closing its connections once nobody is using it
+static void releaseSession(struct dfs_session* session) {
+    pthread_mutex_lock(&session->lock);
+    int refs = --session->refs;
+    pthread_mutex_unlock(&session->lock);
+    if (refs == 0) {
+        int i, j;
+        for (i = 0; i < DFS_SERVERS; i++) {
+            for (j = 0; j < session->idle_count[i]; j++) {
+                close(session->idle[i][j]);
+            }
+        }
+        pthread_mutex_destroy(&session->lock);
+        pthread_cond_destroy(&session->cond);
+        free(session);
+    }
+}
+static void retainSession(struct dfs_session* session) {
+    pthread_mutex_lock(&session->lock);
+    session->refs++;
+    pthread_mutex_unlock(&session->lock);
+}
+void dfsClose(struct dfs_session* session) {
+    // Let background writes finish so every copy a put started gets its chance to land
+    pthread_mutex_lock(&session->lock);
+    while (session->puts > 0) {
+        pthread_cond_wait(&session->cond, &session->lock);
+    }
+    pthread_mutex_unlock(&session->lock);
+    releaseSession(session);
+}
+
+// === Operation Methods ===
+// Frees everything a file array points to
+static void freeFiles(struct dfs_file* files, int file_count) {
+    int i, j;
+    for (i = 0; i < file_count; i++) {
+        for (j = 0; j < 4; j++) {
+            free(files[i].part[j]);
+            free(files[i].alt[j]);
+        }
+    }
+    free(files);
+}
+// Drops a reference to an operation, freeing it once nobody is using it
+static void releaseOp(struct dfs_op* op) {
+    pthread_mutex_lock(&op->lock);
+    int refs = --op->refs;
+    pthread_mutex_unlock(&op->lock);
+    if (refs == 0) {
+        if (op->notify_fd[0] >= 0) {
+            close(op->notify_fd[0]);
+            close(op->notify_fd[1]);
+        }
+        free(op->data);
+        freeFiles(op->files, op->file_count);
+        pthread_mutex_destroy(&op->lock);
+        pthread_cond_destroy(&op->cond);
+        releaseSession(op->session);
+        free(op);
+    }
+}
+// Publishes an operation's result to waiters, its fd and its callback
+static void completeOp(struct dfs_op* op, int status) {
+    pthread_mutex_lock(&op->lock);
+    op->status = status;
+    if (op->notify_fd[1] >= 0) {
+        write(op->notify_fd[1], "", 1);
+    }
+    pthread_cond_broadcast(&op->cond);
+    pthread_mutex_unlock(&op->lock);
+    if (op->callback != NULL) {
+        op->callback(op, op->user_data);
+    }
+}
+int dfsOpStatus(struct dfs_op* op) {
+    pthread_mutex_lock(&op->lock);
+    int status = op->status;
+    pthread_mutex_unlock(&op->lock);
+    return status;
+}
+int dfsOpWait(struct dfs_op* op) {
+    pthread_mutex_lock(&op->lock);
+    while (op->status == DFS_PENDING) {
+        pthread_cond_wait(&op->cond, &op->lock);
+    }
+    int status = op->status;
+    pthread_mutex_unlock(&op->lock);
+    return status;
+}
+int dfsOpFd(struct dfs_op* op) {
+    pthread_mutex_lock(&op->lock);
+    if (op->notify_fd[0] < 0) {
+        if (pipe(op->notify_fd)) {
+            op->notify_fd[0] = op->notify_fd[1] = -1;
+        }
+        // Already done? Then the fd has to be readable straight away
+        else if (op->status != DFS_PENDING) {
+            write(op->notify_fd[1], "", 1);
+        }
+    }
+    int fd = op->notify_fd[0];
+    pthread_mutex_unlock(&op->lock);
+    return fd;
+}
+void const* dfsOpData(struct dfs_op* op, long* size) {
+    *size = op->size;
+    return op->data;
+}
+int dfsOpCopies(struct dfs_op* op) {
+    return op->copies;
+}
+int dfsOpFileCount(struct dfs_op* op) {
+    return op->file_count;
+}
+char const* dfsOpFileName(struct dfs_op* op, int index) {
+    return op->files[index].name;
+}
+int dfsOpFileComplete(struct dfs_op* op, int index) {
+    int j;
+    for (j = 0; j < 4; j++) {
+        if (!op->files[index].present[j]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+void dfsOpFree(struct dfs_op* op) {
+    releaseOp(op);
+}
+long dfsTraceBegin() {
+    return traceBegin();
+}
+void dfsTraceEnd(struct dfs_op* op, char const* name, long start) {
+    if (start == 0) {
+        return;
+    }
+    traceSetRequest(op != NULL ? op->request_id : "");
+    traceEnd(name, start);
+    // The caller's thread has no flush point of its own, so write the span out now
+    traceFlush();
+}
+char const* dfsStrerror(int status) {
+    switch (status) {
+        case DFS_OK:             return "Success";
+        case DFS_PENDING:        return "Operation still running";
+        case DFS_ERR_CONFIG:     return "Error reading config or password file!";
+        case DFS_ERR_LOGIN:      return "Username & password combination not found!";
+        case DFS_ERR_NOT_FOUND:  return "File not found!";
+        case DFS_ERR_INCOMPLETE: return "Parts of file are missing!";
+        case DFS_ERR_QUORUM:     return "Write quorum not reached; too many servers are down!";
+        case DFS_ERR_CONFLICT:   return "Stored parts of file disagree or are damaged!";
+        case DFS_ERR_THREAD:     return "Error starting a thread!";
+    }
+    return "Unknown error";
+}
+
+// === List & Get Methods ===
+// Reads one server's directory items into the file array; returns *1* if the server finished cleanly
+static int drainServer(int server_fd, int with_content, struct dfs_file** dfs_files, int* file_count) {
+    int clean = 0;
+    char *recv_buffer = calloc(1, BUFFSIZE);
+    char *filename = calloc(1, BUFFSIZE);
+    char *filepart = calloc(1, BUFFSIZE);
+    char *partsize = calloc(1, BUFFSIZE);
+    // Continue getting more directory items until done message received
+    while (readFull(server_fd, recv_buffer, BUFFSIZE) == BUFFSIZE) {
+        if (areEqual(recv_buffer, "done")) {
+            clean = 1;
+            break;
+        }
+        if (readFull(server_fd, filename, BUFFSIZE) < BUFFSIZE
+                || readFull(server_fd, filepart, BUFFSIZE) < BUFFSIZE
+                || readFull(server_fd, partsize, BUFFSIZE) < BUFFSIZE) {
+            break;
+        }
+        // Get numeric versions of numeric components
+        int filepart_int = atoi(filepart)-1;
+        int partsize_int = atoi(partsize);
+        if (filepart_int < 0 || filepart_int > 3) {
+            break;
+        }
+        // Servers only send part names and sizes for list
+        char *file_content = NULL;
+        if (with_content) {
+            file_content = malloc(partsize_int > 0 ? partsize_int : 1);
+            if (readFull(server_fd, file_content, partsize_int) < partsize_int) {
+                free(file_content);
+                break;
+            }
+        }
+
+        // Check if in DFS file array
+        int j;
+        int file_index = -1;
+        for(j = 0; j < *file_count; j++) {
+            if(areEqual((*dfs_files)[j].name, filename)) { // Does this file exist in our DFS array?
+                file_index = j;
+                break;
+            }
+        }
+        if(file_index == -1) {
+            (*file_count)++;
+            *dfs_files = realloc(*dfs_files, (*file_count) * sizeof(struct dfs_file));
+            file_index = (*file_count)-1;
+            memset(&(*dfs_files)[file_index], 0, sizeof(struct dfs_file));
+            strcpy((*dfs_files)[file_index].name, filename);
+        }
+        struct dfs_file* file = &(*dfs_files)[file_index];
+        // A replica the size of the one we hold adds nothing; one of another size is stale or torn,
+        // so keep it aside and let reassembly work out which copy fits the rest of the file
+        if(file->present[filepart_int]) {
+            if(file->part_size[filepart_int] != partsize_int && !file->has_alt[filepart_int]) {
+                file->alt[filepart_int] = file_content;
+                file->alt_size[filepart_int] = partsize_int;
+                file->has_alt[filepart_int] = 1;
+            }
+            else {
+                free(file_content);
+            }
+        }
+        else {
+            file->part[filepart_int] = file_content;
+            file->part_size[filepart_int] = partsize_int;
+            file->present[filepart_int] = 1;
+        }
+    }
+    free(recv_buffer);
+    free(filename);
+    free(filepart);
+    free(partsize);
+    return clean;
+}
+// Collects the user's files from every server for "list", or one file's parts for "get"
+// Settles every part whose replicas disagree on the one copy whose size fits the others
+// A put cuts parts 1-3 to the same size and gives part 4 the remainder, so only that layout is whole
+// Returns DFS_ERR_CONFLICT if no choice of copies fits, or more than one does
+static int pickReplicas(struct dfs_file* file) {
+    int fits = 0;
+    int choice = 0;
+    int mask;
+    for (mask = 0; mask < 16; mask++) {
+        int size[4];
+        int j;
+        int usable = 1;
+        for (j = 0; j < 4; j++) {
+            int use_alt = (mask >> j) & 1;
+            if (use_alt && !file->has_alt[j]) {
+                usable = 0;
+            }
+            size[j] = use_alt ? file->alt_size[j] : file->part_size[j];
+        }
+        if (usable && size[0] == size[1] && size[1] == size[2] && size[3] >= size[0] && size[3] < size[0] + 4) {
+            fits++;
+            choice = mask;
+        }
+    }
+    if (fits != 1) {
+        return DFS_ERR_CONFLICT;
+    }
+    int j;
+    for (j = 0; j < 4; j++) {
+        if ((choice >> j) & 1) {
+            char* part = file->part[j];
+            file->part[j] = file->alt[j];
+            file->part_size[j] = file->alt_size[j];
+            file->alt[j] = part;
+        }
+    }
+    return DFS_OK;
+}
+static int runListAndGet(struct dfs_op* op) {
+    struct dfs_session* session = op->session;
+    char const* command = op->type == OP_LIST ? "list" : "get";
+    char const* filename = op->type == OP_LIST ? "null_filename" : op->filename;
+    int server_fd[DFS_SERVERS];
+    int reused[DFS_SERVERS];
+
+    // Send every request first so the servers all work while we drain them one by one
+    int i;
+    for(i = 0; i < DFS_SERVERS; i++) {
+        server_fd[i] = acquireConnection(session, i, &reused[i]);
+        if(server_fd[i] >= 0 && !sendRequest(server_fd[i], command, filename, session->username, op->request_id)) {
+            close(server_fd[i]);
+            server_fd[i] = -1;
+        }
+    }
+    struct dfs_file* dfs_files = NULL;
+    int file_count = 0;
+    for(i = 0; i < DFS_SERVERS; i++) {
+        // Don't wait on a server that is down!
+        if(server_fd[i] < 0) {
+            continue;
+        }
+        long span = traceBegin();
+        int clean = drainServer(server_fd[i], op->type == OP_GET, &dfs_files, &file_count);
+        // A pooled connection may have gone stale while idle; try once more on a fresh one
+        if(!clean && reused[i]) {
+            close(server_fd[i]);
+            server_fd[i] = connectServer(session, i);
+            if(server_fd[i] >= 0 && sendRequest(server_fd[i], command, filename, session->username, op->request_id)) {
+                clean = drainServer(server_fd[i], op->type == OP_GET, &dfs_files, &file_count);
+            }
+        }
+        traceEnd("network transfer", span);
+        if(clean) {
+            releaseConnection(session, i, server_fd[i]);
+        }
+        else if(server_fd[i] >= 0) {
+            close(server_fd[i]);
+        }
+    }
+
+    if(op->type == OP_LIST) {
+        op->files = dfs_files;
+        op->file_count = file_count;
+        return DFS_OK;
+    }
+
+    // Reassemble the requested file
+    long span = traceBegin();
+    int status = DFS_ERR_NOT_FOUND;
+    for(i = 0; i < file_count; i++) {
+        if(areEqual(dfs_files[i].name, op->filename)) {
+            int j;
+            status = DFS_OK;
+            for (j = 0; j < 4; j++) {
+                if (!dfs_files[i].present[j]) {
+                    status = DFS_ERR_INCOMPLETE;
+                }
+            }
+            if(status == DFS_OK) {
+                status = pickReplicas(&dfs_files[i]);
+            }
+            if(status == DFS_OK) {
+                op->size = 0;
+                for (j = 0; j < 4; j++) {
+                    op->size += dfs_files[i].part_size[j];
+                }
+                op->data = malloc(op->size > 0 ? op->size : 1);
+                long offset = 0;
+                for (j = 0; j < 4; j++) {
+                    memcpy(op->data + offset, dfs_files[i].part[j], dfs_files[i].part_size[j]);
+                    offset += dfs_files[i].part_size[j];
+                }
+            }
+            break;
+        }
+    }
+    freeFiles(dfs_files, file_count);
+    traceEnd("reassembly", span);
+    return status;
+}
+
+// === Put Methods ===
+// Drops a reference to a put job, freeing it once nobody is using it
+static void releasePutJob(struct put_job* job) {
+    pthread_mutex_lock(&job->lock);
+    int refs = --job->refs;
+    pthread_mutex_unlock(&job->lock);
+    if(refs == 0) {
+        int i;
+        for(i = 0; i < 4; i++) {
+            free(job->part[i]);
+        }
+        pthread_mutex_destroy(&job->lock);
+        pthread_cond_destroy(&job->cond);
+        pthread_mutex_lock(&job->session->lock);
+        job->session->puts--;
+        pthread_cond_broadcast(&job->session->cond);
+        pthread_mutex_unlock(&job->session->lock);
+        releaseSession(job->session);
+        free(job);
+    }
+}
+// Returns *1* once every part either has the quorum or can no longer reach it; caller holds the lock
+static int putSettled(struct put_job* job) {
+    int p;
+    for(p = 0; p < 4; p++) {
+        int pending = DFS_REPLICAS - job->acks[p] - job->failed[p];
+        if(job->acks[p] < job->session->write_quorum && job->acks[p] + pending >= job->session->write_quorum) {
+            return 0;
+        }
+    }
+    return 1;
+}
+// Sends one part to a server and waits for its ack; returns *1* once the server has it on disk
+static int sendPart(int server_fd, struct put_job* job, int p) {
+    char *header = calloc(2, BUFFSIZE);
+    sprintf(header, "%d", p+1);
+    sprintf(header + BUFFSIZE, "%ld", job->part_size[p]);
+    // Send the components and the part!
+    long span = traceBegin();
+    int sent = writeFull(server_fd, header, 2*BUFFSIZE) && writeFull(server_fd, job->part[p], job->part_size[p]);
+    traceEnd("network transfer", span);
+    // Wait for the server to confirm the part is persisted
+    int acked = 0;
+    if(sent) {
+        span = traceBegin();
+        char *ack = calloc(1, BUFFSIZE);
+        acked = readFull(server_fd, ack, BUFFSIZE) == BUFFSIZE && strncmp(ack, "ack", 3) == 0;
+        free(ack);
+        traceEnd("ack wait", span);
+    }
+    free(header);
+    return acked;
+}
+// Writes both of a server's parts, reconnecting and retrying until acked or out of retries
+static void* putWriter(void* arg) {
+    struct put_writer* w = arg;
+    struct put_job* job = w->job;
+    struct dfs_session* session = job->session;
+    // Figure out which parts we're sending to this server
+    int p[] = {(4 + w->server_id - job->v) %4, (5 + w->server_id - job->v) %4};
+    int acked[] = {0, 0};
+    traceSetRequest(job->request_id);
+
+    int server_fd = -1;
+    int attempt;
+    for(attempt = 0; attempt <= PUT_RETRIES && !(acked[0] && acked[1]); attempt++) {
+        int repair = 0;
+        if(attempt == 0) {
+            int reused;
+            server_fd = acquireConnection(session, w->server_id, &reused);
+        }
+        else {
+            // Retry at once in case a pooled connection had gone stale, then back off
+            if(server_fd >= 0) {
+                close(server_fd);
+            }
+            sleep(attempt - 1);
+            server_fd = connectServer(session, w->server_id);
+            // Once the put has completed, retries are background repair and yield to interactive work
+            pthread_mutex_lock(&job->lock);
+            repair = putSettled(job);
+            pthread_mutex_unlock(&job->lock);
+        }
+        // Tell the server how many bytes are coming so its scheduler can charge them up front
+        char command[64];
+        sprintf(command, "%s %ld", repair ? "repair" : "put", job->part_size[p[0]] + job->part_size[p[1]]);
+        if(server_fd < 0 || !sendRequest(server_fd, command, job->filename, session->username, job->request_id)) {
+            continue;
+        }
+        // The server always expects both parts, so resend any already acked
+        int k;
+        int clean = 1;
+        for(k = 0; k < DFS_REPLICAS && clean; k++) {
+            clean = sendPart(server_fd, job, p[k]);
+            if(clean && !acked[k]) {
+                acked[k] = 1;
+                pthread_mutex_lock(&job->lock);
+                job->acks[p[k]]++;
+                pthread_cond_broadcast(&job->cond);
+                pthread_mutex_unlock(&job->lock);
+            }
+        }
+        if(clean) {
+            releaseConnection(session, w->server_id, server_fd);
+            server_fd = -1;
+        }
+    }
+    if(server_fd >= 0) {
+        close(server_fd);
+    }
+
+    // Record the copies we gave up on so the put doesn't wait for them
+    int k;
+    pthread_mutex_lock(&job->lock);
+    for(k = 0; k < DFS_REPLICAS; k++) {
+        if(!acked[k]) {
+            job->failed[p[k]]++;
+        }
+    }
+    pthread_cond_broadcast(&job->cond);
+    pthread_mutex_unlock(&job->lock);
+
+    releasePutJob(job);
+    free(w);
+    traceFlush();
+    return NULL;
+}
+// Splits the data across the servers; completes as soon as every part has the write quorum
+static int runPut(struct dfs_op* op) {
+    struct dfs_session* session = op->session;
+    // Decide how to cut up file
+    long span = traceBegin();
+    char* hash = str2md5(op->data, op->size);
+    traceEnd("hashing", span);
+    char last_hex = hash[strlen(hash) - 1];
+    int v = hex2int(last_hex) % 4;
+    free(hash);
+
+    // Cut up, sticking the remainder into section 4
+    long remainder = op->size%4;
+    long part_size = op->size/4;
+
+    // The job owns the parts from here on; one reference for us and one per writer
+    struct put_job* job = calloc(1, sizeof(struct put_job));
+    int i;
+    for(i = 0; i < 4; i++) {
+        job->part_size[i] = i == 3 ? part_size + remainder : part_size;
+        job->part[i] = malloc(job->part_size[i] > 0 ? job->part_size[i] : 1);
+        memcpy(job->part[i], op->data + i*part_size, job->part_size[i]);
+    }
+    free(op->data);
+    op->data = NULL;
+    op->size = 0;
+    job->session = session;
+    retainSession(session);
+    strcpy(job->filename, op->filename);
+    strcpy(job->request_id, op->request_id);
+    job->v = v;
+    job->refs = DFS_SERVERS + 1;
+    pthread_mutex_init(&job->lock, NULL);
+    pthread_cond_init(&job->cond, NULL);
+
+    for(i = 0; i < DFS_SERVERS; i++) {
+        struct put_writer* w = malloc(sizeof(struct put_writer));
+        w->job = job;
+        w->server_id = i;
+        pthread_t thread;
+        if(pthread_create(&thread, NULL, putWriter, w) != 0) {
+            // Count this server's copies as given up on, just as its writer would have
+            pthread_mutex_lock(&job->lock);
+            job->failed[(4 + i - v) %4]++;
+            job->failed[(5 + i - v) %4]++;
+            pthread_mutex_unlock(&job->lock);
+            releasePutJob(job);
+            free(w);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+
+    // Wait only until the quorum is met (or can't be)
+    span = traceBegin();
+    pthread_mutex_lock(&job->lock);
+    while(!putSettled(job)) {
+        pthread_cond_wait(&job->cond, &job->lock);
+    }
+    op->copies = DFS_REPLICAS;
+    for(i = 0; i < 4; i++) {
+        if(job->acks[i] < op->copies) {
+            op->copies = job->acks[i];
+        }
+    }
+    pthread_mutex_unlock(&job->lock);
+    traceEnd("quorum wait", span);
+    releasePutJob(job);
+    return op->copies >= session->write_quorum ? DFS_OK : DFS_ERR_QUORUM;
+}
+
+// === Operation Threads ===
+// Runs one operation start to finish on its own thread
+static void* runOp(void* arg) {
+    struct dfs_op* op = arg;
+    traceSetRequest(op->request_id);
+    long span = traceBegin();
+    int status;
+    if(op->type == OP_PUT) {
+        status = runPut(op);
+        traceEnd("put", span);
+    }
+    else {
+        status = runListAndGet(op);
+        traceEnd(op->type == OP_LIST ? "list" : "get", span);
+    }
+    completeOp(op, status);
+    releaseOp(op);
+    traceFlush();
+    return NULL;
+}
+// Creates an operation and starts its thread
+static struct dfs_op* startOp(struct dfs_session* session, int type, char const* filename, char* data, long size, dfs_callback callback, void* user_data) {
+    struct dfs_op* op = calloc(1, sizeof(struct dfs_op));
+    op->session = session;
+    retainSession(session);
+    op->type = type;
+    snprintf(op->filename, BUFFSIZE, "%s", filename);
+    traceNewRequest(op->request_id);
+    op->data = data;
+    op->size = size;
+    op->status = DFS_PENDING;
+    op->refs = 2;
+    op->notify_fd[0] = op->notify_fd[1] = -1;
+    op->callback = callback;
+    op->user_data = user_data;
+    pthread_mutex_init(&op->lock, NULL);
+    pthread_cond_init(&op->cond, NULL);
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, runOp, op) != 0) {
+        // No put job will be made to release the count dfsPut() took
+        if (type == OP_PUT) {
+            pthread_mutex_lock(&session->lock);
+            session->puts--;
+            pthread_cond_broadcast(&session->cond);
+            pthread_mutex_unlock(&session->lock);
+        }
+        completeOp(op, DFS_ERR_THREAD);
+        releaseOp(op);
+        return op;
+    }
+    pthread_detach(thread);
+    return op;
+}
+struct dfs_op* dfsPut(struct dfs_session* session, char const* filename, void const* data, long size, dfs_callback callback, void* user_data) {
+    char* copy = malloc(size > 0 ? size : 1);
+    memcpy(copy, data, size);
+    // Counted before the thread starts so a dfsClose() right after this still waits for it
+    pthread_mutex_lock(&session->lock);
+    session->puts++;
+    pthread_mutex_unlock(&session->lock);
+    return startOp(session, OP_PUT, filename, copy, size, callback, user_data);
+}
+struct dfs_op* dfsGet(struct dfs_session* session, char const* filename, dfs_callback callback, void* user_data) {
+    return startOp(session, OP_GET, filename, NULL, 0, callback, user_data);
+}
+struct dfs_op* dfsList(struct dfs_session* session, dfs_callback callback, void* user_data) {
+    return startOp(session, OP_LIST, "", NULL, 0, callback, user_data);
+}
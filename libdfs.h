@@ -0,0 +1,77 @@
+#ifndef LIBDFS_H
+#define LIBDFS_H
+
+// Client library for the DFS
+// A session logs a user in and keeps pooled connections to the servers. Put, get and list return
+// right away and run on background threads; wait on the operation, poll its fd, or pass a callback
+// Every call is thread safe, and one session can have any number of operations in flight
+
+// The library is built with hidden visibility; only declarations marked DFS_API are exported
+#define DFS_API __attribute__((visibility("default")))
+
+#define DFS_SERVERS 4           // Servers a file is spread across
+#define DFS_REPLICAS 2          // Servers holding each part
+
+// === Status codes ===
+#define DFS_OK 0
+#define DFS_PENDING 1           // Operation is still running
+#define DFS_ERR_CONFIG -1       // Config or password file is missing or malformed
+#define DFS_ERR_LOGIN -2        // Username & password combination not found
+#define DFS_ERR_NOT_FOUND -3    // No reachable server has any part of the file
+#define DFS_ERR_INCOMPLETE -4   // Some parts of the file are on no reachable server
+#define DFS_ERR_QUORUM -5       // Too many servers are down to store every part WriteQuorum times
+#define DFS_ERR_CONFLICT -6     // Stored parts of the file don't fit together, whichever replicas are used
+#define DFS_ERR_THREAD -7       // The library couldn't start a thread to run the operation
+
+struct dfs_session;
+struct dfs_op;
+
+// Called on a library thread once an operation finishes; the operation may be freed from here
+// If the operation couldn't be started, it is called on the calling thread before the call returns
+typedef void (*dfs_callback)(struct dfs_op* op, void* user_data);
+
+// === Sessions ===
+// Logs in against the password file that sits next to config_path (NULL means "dfc.conf")
+// Returns NULL and sets *status on failure
+DFS_API struct dfs_session* dfsOpen(char const* config_path, char const* username, char const* password, int* status);
+// Waits for background put writes to finish, then releases the session
+// Operations the caller hasn't freed yet keep the session alive until they are
+DFS_API void dfsClose(struct dfs_session* session);
+
+// === Operations ===
+// Stores size bytes of data as filename; data is copied, so it may be reused right away
+// Completes once every part has WriteQuorum durable copies; the remaining copies finish in the background
+DFS_API struct dfs_op* dfsPut(struct dfs_session* session, char const* filename, void const* data, long size, dfs_callback callback, void* user_data);
+// Reassembles filename into memory; read it with dfsOpData()
+DFS_API struct dfs_op* dfsGet(struct dfs_session* session, char const* filename, dfs_callback callback, void* user_data);
+// Lists the user's files; read them with dfsOpFileCount(), dfsOpFileName() and dfsOpFileComplete()
+DFS_API struct dfs_op* dfsList(struct dfs_session* session, dfs_callback callback, void* user_data);
+
+// Returns DFS_PENDING while the operation runs, then its final status
+DFS_API int dfsOpStatus(struct dfs_op* op);
+// Blocks until the operation finishes and returns its status
+DFS_API int dfsOpWait(struct dfs_op* op);
+// Returns an fd that becomes readable once the operation finishes, for use with poll() or select()
+DFS_API int dfsOpFd(struct dfs_op* op);
+// Returns the bytes a finished get produced; owned by the operation
+DFS_API void const* dfsOpData(struct dfs_op* op, long* size);
+// Returns how many durable copies of every part a finished put had when it completed
+DFS_API int dfsOpCopies(struct dfs_op* op);
+DFS_API int dfsOpFileCount(struct dfs_op* op);
+DFS_API char const* dfsOpFileName(struct dfs_op* op, int index);
+// Returns *1* if every part of the listed file is on a reachable server
+DFS_API int dfsOpFileComplete(struct dfs_op* op, int index);
+// Releases the operation; if it is still running, its result is discarded when it finishes
+DFS_API void dfsOpFree(struct dfs_op* op);
+
+DFS_API char const* dfsStrerror(int status);
+
+// === Tracing ===
+// Lets a program add its own spans, such as its file I/O, to the library's trace when DFS_TRACE is set
+// Returns a start timestamp to hand to dfsTraceEnd(), or 0 when tracing is off
+DFS_API long dfsTraceBegin();
+// Records a span from start until now, tagged with op's request ID (op may be NULL)
+// name must be a string literal, as only the pointer is kept
+DFS_API void dfsTraceEnd(struct dfs_op* op, char const* name, long start);
+
+#endif
@@ -0,0 +1,15 @@
+# Joins the trace files written under $DFS_TRACE (or the given directory) into one Chrome trace
+# Usage: ./merge_traces.sh [trace directory] > trace.json, then open it in chrome://tracing or ui.perfetto.dev
+dir="${1:-$DFS_TRACE}"
+if [ -z "$dir" ] || [ ! -d "$dir" ]; then
+    echo "usage: $0 [trace directory] > trace.json (or set DFS_TRACE)" >&2
+    exit 1
+fi
+set -- "$dir"/*.json
+if [ ! -e "$1" ]; then
+    echo "No trace files in $dir" >&2
+    exit 1
+fi
+echo "["
+cat "$@" | grep -v '^\[$' | sed '$ s/,$//'
+echo "]"